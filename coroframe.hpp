@@ -0,0 +1,115 @@
+// Coroutine frame allocation from the allocator in main.c (see memoryhelp.h for linking it in)
+// A promise type that derives from CoroFrameAllocator gets its frames from per-thread pools keyed by frame size
+// instead of the global operator new. Each pool is a slab cache for one 16-byte size class, and a frame that is
+// destroyed goes onto the calling thread's recycling list for its class first, so the next frame of that size is
+// taken from the list without a lock. Frames larger than kMaxPooledFrame come from my_alloc_ex.
+//
+//     struct promise_type : CoroFrameAllocator { ... };
+//
+// my_initialize_heap must have run before the first frame is allocated.
+#ifndef COROFRAME_HPP
+#define COROFRAME_HPP
+
+#include <cstddef>
+#include <new>
+
+#include "memoryhelp.h"
+
+class CoroFrameAllocator
+{
+public:
+    static constexpr std::size_t kFrameGranule = 16;    // Frame sizes are rounded up to a multiple of this
+    static constexpr std::size_t kMaxPooledFrame = 2048; // Larger frames go to my_alloc_ex
+    static constexpr int kMaxRecycled = 64;               // Frames a thread keeps per class before giving them back
+
+    // Frames must be aligned like anything from the global operator new. Slab objects are a multiple of the granule
+    // apart from a cache-line-aligned start, and the larger frames ask my_alloc_ex for the alignment explicitly.
+    static constexpr std::size_t kFrameAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    static_assert(kFrameGranule % kFrameAlignment == 0, "pooled frames would be misaligned");
+
+    static void *operator new(std::size_t size)
+    {
+        std::size_t sizeClass = (size + kFrameGranule - 1) / kFrameGranule;
+        void *frame;
+        if (sizeClass * kFrameGranule > kMaxPooledFrame)
+        {
+            frame = my_alloc_ex(static_cast<int>(size), 0, static_cast<int>(kFrameAlignment));
+        }
+        else
+        {
+            ThreadPools &pools = threadPools();
+            frame = pools.recycled[sizeClass];
+            if (frame != nullptr)
+            {
+                pools.recycled[sizeClass] = *static_cast<void **>(frame);
+                pools.recycledCount[sizeClass]--;
+            }
+            else
+            {
+                if (pools.caches[sizeClass] == nullptr)
+                    pools.caches[sizeClass] = my_slab_create(static_cast<int>(sizeClass * kFrameGranule), 0);
+                frame = pools.caches[sizeClass] != nullptr ? my_slab_alloc(pools.caches[sizeClass]) : nullptr;
+            }
+        }
+        if (frame == nullptr)
+            throw std::bad_alloc();
+        return frame;
+    }
+
+    // The size is the one the frame was allocated with, so it names the same class.
+    // A frame may be destroyed on another thread than the one that made it; it then joins that thread's list,
+    // which is fine because every frame of a class fits every other.
+    static void operator delete(void *frame, std::size_t size)
+    {
+        if (frame == nullptr)
+            return;
+        std::size_t sizeClass = (size + kFrameGranule - 1) / kFrameGranule;
+        if (sizeClass * kFrameGranule > kMaxPooledFrame)
+        {
+            my_free(frame);
+            return;
+        }
+        ThreadPools &pools = threadPools();
+        if (pools.recycledCount[sizeClass] >= kMaxRecycled)
+        {
+            my_slab_free(frame); // The slab remembers which cache it belongs to
+            return;
+        }
+        *static_cast<void **>(frame) = pools.recycled[sizeClass];
+        pools.recycled[sizeClass] = frame;
+        pools.recycledCount[sizeClass]++;
+    }
+
+private:
+    static constexpr std::size_t kClasses = kMaxPooledFrame / kFrameGranule + 1;
+
+    // One thread's pools. The recycled frames go back to their slabs when the thread exits; the slab caches stay,
+    // since frames from them may still be alive on other threads.
+    struct ThreadPools
+    {
+        SlabCache *caches[kClasses] = {};
+        void *recycled[kClasses] = {};
+        int recycledCount[kClasses] = {};
+
+        ~ThreadPools()
+        {
+            for (std::size_t sizeClass = 0; sizeClass < kClasses; sizeClass++)
+            {
+                while (recycled[sizeClass] != nullptr)
+                {
+                    void *next = *static_cast<void **>(recycled[sizeClass]);
+                    my_slab_free(recycled[sizeClass]);
+                    recycled[sizeClass] = next;
+                }
+            }
+        }
+    };
+
+    static ThreadPools &threadPools()
+    {
+        static thread_local ThreadPools pools;
+        return pools;
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+// Coroutine frame churn benchmark: CoroFrameAllocator against the global operator new/delete
+// Build (main.c without its own main):
+//     gcc -O2 -pthread -DMEMORYHELP_NO_MAIN -c main.c -o memoryhelp.o
+//     g++ -std=c++20 -O2 -pthread coroframe_bench.cpp memoryhelp.o -o coroframe_bench
+// Run: ./coroframe_bench [frames]
+#include <chrono>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+
+#include "coroframe.hpp"
+
+// Minimal lazily started task; Base decides where its frames come from
+template <typename Base>
+struct Task
+{
+    struct promise_type : Base
+    {
+        long value = 0;
+
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_value(long result)
+        {
+            value = result;
+        }
+        void unhandled_exception()
+        {
+            std::abort();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct GlobalNew
+{
+};
+
+// Coroutine with a few locals, so its frame is a realistic size
+template <typename Base>
+Task<Base> work(long seed)
+{
+    long buffer[8];
+    for (int i = 0; i < 8; i++)
+        buffer[i] = seed * i;
+    co_await std::suspend_always{};
+    long sum = 0;
+    for (int i = 0; i < 8; i++)
+        sum += buffer[i];
+    co_return sum;
+}
+
+// Function to create, run and destroy frames, keeping a window of them alive so none can be elided
+template <typename Base>
+static double churn(long frames, long *checksum)
+{
+    enum { WINDOW = 64 };
+    std::coroutine_handle<typename Task<Base>::promise_type> window[WINDOW] = {};
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < frames; i++)
+    {
+        auto &slot = window[i % WINDOW];
+        if (slot)
+        {
+            slot.resume(); // Runs to the end
+            *checksum += slot.promise().value;
+            slot.destroy();
+        }
+        slot = work<Base>(i).handle;
+        slot.resume(); // Runs to the co_await
+    }
+    for (auto &slot : window)
+    {
+        if (slot)
+            slot.destroy();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / frames;
+}
+
+int main(int argc, char *argv[])
+{
+    long frames = argc > 1 ? atol(argv[1]) : 10000000L;
+    if (frames <= 0)
+    {
+        printf("Frames must be greater than 0.\n");
+        return 1;
+    }
+    my_initialize_heap(64 << 20);
+
+    long checksumGlobal = 0, checksumPooled = 0;
+    double globalNs = churn<GlobalNew>(frames, &checksumGlobal);
+    double pooledNs = churn<CoroFrameAllocator>(frames, &checksumPooled);
+
+    printf("Frames: %ld (checksums %ld / %ld)\n", frames, checksumGlobal, checksumPooled);
+    printf("Global new/delete: %.1f ns per frame\n", globalNs);
+    printf("CoroFrameAllocator: %.1f ns per frame\n", pooledNs);
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Interface of the allocator in main.c for other translation units (C or C++).
+// Build main.c with -DMEMORYHELP_NO_MAIN to link the allocator into another program without its menu and benchmarks.
+#ifndef MEMORYHELP_H
+#define MEMORYHELP_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flags accepted by the allocation entry points
+#define MY_ALLOC_EMERGENCY 0x1      // May dip into the emergency reserve when the heap is exhausted
+#define MY_ALLOC_ZERO 0x2           // Clear the memory before returning it
+#define MY_ALLOC_SHORT_LIVED 0x4    // Expected to be freed soon (the default region)
+#define MY_ALLOC_LONG_LIVED 0x8     // Expected to outlive most allocations (the long-lived region)
+#define MY_ALLOC_COLD 0x10          // Rarely touched (the cold region)
+#define MY_ALLOC_CACHE_ALIGNED 0x20 // Shared between threads: give the object cache lines of its own
+
+// Ends of a double-ended stack
+#define MY_STACK_LOW 0  // End that grows towards higher addresses
+#define MY_STACK_HIGH 1 // End that grows towards lower addresses
+
+#define MY_MAX_TAGS 64          // Allocation tags are 0 (untagged) to MY_MAX_TAGS - 1
+#define RESERVE_MAX_CLASSES 16  // Size classes a HeapReserveProfile can name
+
+struct SlabCache;
+struct RingBuffer;
+struct StackAllocator;
+
+// Heap usage and budget counters, filled in by my_heap_stats
+struct HeapStats
+{
+    long bytes_in_use;           // Bytes in allocated blocks (headers included)
+    long soft_limit;             // Current soft limit (0 = none)
+    long hard_limit;             // Current hard limit (0 = none)
+    long hard_limit_refusals;    // Allocations refused because of the hard limit
+    long reclaim_runs;           // Times the heap purged and ran the reclaim callbacks
+    long reclaim_bytes_freed;    // Bytes the reclaim callbacks reported as freed
+    long emergency_target;       // Bytes the emergency reserve should hold
+    long emergency_held;         // Bytes it holds right now
+    long emergency_taps;         // Allocations served from the reserve
+    long emergency_bytes_tapped; // Bytes handed out from the reserve
+    long emergency_failed_taps;  // Emergency allocations that failed even with the reserve
+    long emergency_refills;      // Freed blocks that went back to the reserve
+    long wilderness_bytes;       // Bytes in the untouched top of the heap (0 once it is used up)
+    long vbuf_committed;         // Bytes committed to virtual buffers (counted against the limits)
+    long vbuf_reserved;          // Address space reserved by virtual buffers
+    long large_blocks;           // Large blocks mapped directly (see large_threshold)
+    long large_bytes;            // Bytes of their mappings
+};
+
+// Per-tag accounting, filled in by my_tag_stats
+struct TagStats
+{
+    long live_bytes;  // Bytes currently allocated under the tag (headers included)
+    long peak_bytes;  // Highest live_bytes seen
+    long allocations; // Allocations made under the tag
+    long frees;       // Frees of blocks carrying the tag
+};
+
+// Reservation profile for my_heap_reserve: everything a latency-critical phase should not pay for later
+struct HeapReserveProfile
+{
+    int prefault;                          // Nonzero to touch every heap page now, so no page faults happen later
+    int lock_pages;                        // Nonzero to mlock the heap, so the pages can never be swapped out
+    int class_count;                       // Number of entries used in the two arrays below
+    int class_sizes[RESERVE_MAX_CLASSES];  // Request sizes (in bytes) to pre-split blocks for
+    int class_blocks[RESERVE_MAX_CLASSES]; // Number of blocks to pre-split for each size
+};
+
+// How much of the reservation has been handed out since my_heap_reserve
+struct HeapReserveReport
+{
+    long blocks_reserved; // Blocks that were pre-split
+    long blocks_used;     // Pre-split blocks my_alloc has handed out at least once
+    long bytes_reserved;  // Bytes (headers included) that were pre-split
+    long bytes_used;      // Bytes (headers included) of the pre-split blocks that were handed out
+};
+
+// A buffer that grows in place inside address space reserved up front (read the fields, never write them)
+struct VirtualBuffer
+{
+    char *data;      // Start of the reserved range (page-aligned, never changes)
+    long size;       // Bytes the owner asked for with my_vbuf_grow
+    long committed;  // Bytes at the start of the range that are readable and writable (whole pages)
+    long reserved;   // Bytes of address space reserved; size can never grow beyond this
+};
+
+// Called when the heap is short of memory: frees up to bytesWanted bytes of cached entries, returns the bytes freed
+typedef long (*my_reclaim_callback)(long bytesWanted, void *context);
+
+// The heap
+void my_initialize_heap(int size);
+void *my_alloc(int size);
+void *my_alloc_ex(int size, unsigned flags, int align);
+void *my_alloc_near(void *hint, int size);
+void *my_alloc_emergency(int size);
+void my_free(void *ptr);
+long my_heap_purge(void);
+int my_owns(const void *ptr);
+int my_configure(const char *conf);
+void my_adaptive_log_print(FILE *out);
+long my_trace_export(const char *path);
+
+// Limits, reclaiming and the emergency reserve
+void my_heap_set_limits(long softLimit, long hardLimit);
+void my_heap_stats(struct HeapStats *stats);
+int my_register_reclaim_callback(my_reclaim_callback callback, void *context);
+void my_unregister_reclaim_callback(my_reclaim_callback callback, void *context);
+long my_heap_set_emergency_reserve(long bytes);
+void my_set_emergency_state(int on);
+
+// Reservation and real-time mode
+int my_heap_reserve(const struct HeapReserveProfile *profile);
+void my_heap_reserve_report(struct HeapReserveReport *report);
+int my_enable_realtime_mode(void);
+
+// Allocation tags and site prediction
+void *my_alloc_tagged(int size, unsigned tag);
+unsigned my_set_current_tag(unsigned tag);
+void my_tag_set_name(unsigned tag, const char *name);
+int my_tag_stats(unsigned tag, struct TagStats *stats);
+void my_tag_stats_export(FILE *out);
+void my_set_site_prediction(int on);
+void my_site_stats_print(FILE *out);
+
+// Deferred frees: asynchronous frees, the reclaimer thread and epoch-based retirement
+int my_free_async(void *ptr);
+int my_drain_async_frees(void);
+int my_reclaimer_start(unsigned interval_us);
+void my_reclaimer_stop(void);
+long my_async_backpressure_count(void);
+void my_epoch_enter(void);
+void my_epoch_exit(void);
+int my_epoch_reclaim(void);
+void my_retire(void *ptr);
+
+// Slab caches
+struct SlabCache *my_slab_create(int objectSize, int coloring);
+void *my_slab_alloc(struct SlabCache *cache);
+void my_slab_free(void *object);
+void my_slab_destroy(struct SlabCache *cache);
+
+// Ring buffers
+struct RingBuffer *my_ring_create(int bytes);
+void *my_ring_alloc(struct RingBuffer *ring, int size);
+void my_ring_free(struct RingBuffer *ring, void *ptr);
+void my_ring_destroy(struct RingBuffer *ring);
+
+// Double-ended stacks
+struct StackAllocator *my_stack_create(int bytes, int checked);
+void *my_stack_push(struct StackAllocator *stack, int end, int size);
+int my_stack_pop(struct StackAllocator *stack, int end, void *ptr, int size);
+void my_stack_reset(struct StackAllocator *stack);
+void my_stack_destroy(struct StackAllocator *stack);
+
+// Virtual buffers
+struct VirtualBuffer *my_vbuf_create(long maxBytes);
+int my_vbuf_grow(struct VirtualBuffer *buf, long newSize);
+void my_vbuf_destroy(struct VirtualBuffer *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
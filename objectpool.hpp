@@ -0,0 +1,198 @@
+// Typed object pool on top of the allocator in main.c (see memoryhelp.h for linking it in)
+// Objects of one type live in slots of exactly sizeof(T) bytes, packed into pages taken from the heap, so they carry
+// no block header and never go through the free-list search of my_alloc. Each page keeps an occupancy bitmap, which
+// finds free slots and lets clear() destroy every live object without any record besides the bitmaps.
+// A pool has no lock: it is meant to be owned by one thread.
+#ifndef OBJECTPOOL_HPP
+#define OBJECTPOOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "memoryhelp.h"
+
+template <typename T>
+class ObjectPool
+{
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    ~ObjectPool()
+    {
+        clear();
+    }
+
+    // Function to construct a T in a free slot; returns nullptr when the heap cannot supply another page
+    // The slot is taken before the constructor runs (so a constructor that emplaces into the same pool gets another
+    // slot), and given back if the constructor throws, so the pool never counts or destroys an unconstructed object.
+    template <typename... Args>
+    T *emplace(Args &&...args)
+    {
+        void *slot = takeSlot();
+        if (slot == nullptr)
+            return nullptr;
+#if defined(__cpp_exceptions)
+        try
+        {
+            return ::new (slot) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            releaseSlot(static_cast<T *>(slot));
+            throw;
+        }
+#else
+        return ::new (slot) T(std::forward<Args>(args)...);
+#endif
+    }
+
+    // Function to destroy an object made by emplace and recycle its slot for the next emplace
+    void destroy(T *object)
+    {
+        if (object == nullptr)
+            return;
+        object->~T();
+        releaseSlot(object);
+    }
+
+    // Function to destroy every live object and give all pages back to the heap
+    // Destructors run page by page over the bits set in the occupancy bitmaps (skipped for trivial types).
+    void clear()
+    {
+        for (Page *page = pages; page != nullptr;)
+        {
+            Page *next = page->next;
+            if (!std::is_trivially_destructible<T>::value)
+            {
+                for (std::size_t word = 0; word < kBitmapWords; word++)
+                {
+                    for (std::uint64_t bits = page->occupied[word]; bits != 0; bits &= bits - 1)
+                    {
+                        std::size_t index = word * 64 + __builtin_ctzll(bits);
+                        reinterpret_cast<T *>(page->slots() + index * sizeof(T))->~T();
+                    }
+                }
+            }
+            my_free(page);
+            page = next;
+        }
+        pages = nullptr;
+        freePages = nullptr;
+        live = 0;
+    }
+
+    // Number of live objects
+    std::size_t size() const
+    {
+        return live;
+    }
+
+    // Slots each page holds
+    static constexpr std::size_t slotsPerPage()
+    {
+        return kSlotsPerPage;
+    }
+
+private:
+    // Pages are aligned on their own size, so the page of an object is found by masking its address
+    static constexpr std::size_t kMinPageBytes = 4096;
+    static constexpr std::size_t kMinSlots = 8;
+
+    static constexpr std::size_t roundUp(std::size_t value, std::size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    static constexpr std::size_t powerOfTwoAtLeast(std::size_t value)
+    {
+        std::size_t result = 1;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    // Upper bound on the bitmap, from the most slots a page could hold if it had no header
+    static constexpr std::size_t kSlotAlign = alignof(T) > alignof(std::uint64_t) ? alignof(T) : alignof(std::uint64_t);
+    static constexpr std::size_t kHeaderGuess = 64 + kSlotAlign;
+    static constexpr std::size_t kPageBytes = powerOfTwoAtLeast(
+        kMinPageBytes > kHeaderGuess + kMinSlots * sizeof(T) ? kMinPageBytes : kHeaderGuess + kMinSlots * sizeof(T));
+    static constexpr std::size_t kBitmapWords = (kPageBytes / sizeof(T) + 63) / 64;
+
+    struct Page
+    {
+        Page *next;                          // Next page of the pool (all pages)
+        Page *next_free;                     // Next page with a free slot
+        std::size_t live;                    // Occupied slots
+        std::uint64_t occupied[kBitmapWords]; // One bit per slot, set while the slot holds an object
+
+        char *slots()
+        {
+            return reinterpret_cast<char *>(this) + kSlotOffset;
+        }
+    };
+
+    static constexpr std::size_t kSlotOffset = roundUp(sizeof(Page), alignof(T));
+    static constexpr std::size_t kSlotsPerPage = (kPageBytes - kSlotOffset) / sizeof(T);
+    static_assert(kSlotsPerPage <= kBitmapWords * 64, "the bitmap must cover every slot");
+    static_assert(kPageBytes <= 0x40000000, "objects too large for a pool page");
+
+    static Page *pageOf(T *object)
+    {
+        return reinterpret_cast<Page *>(reinterpret_cast<std::uintptr_t>(object) & ~(std::uintptr_t)(kPageBytes - 1));
+    }
+
+    // Function to find a free slot, taking a new page from the heap when every page is full
+    void *takeSlot()
+    {
+        if (freePages == nullptr)
+        {
+            void *memory = my_alloc_ex(static_cast<int>(kPageBytes), 0, static_cast<int>(kPageBytes));
+            if (memory == nullptr)
+                return nullptr;
+            Page *page = static_cast<Page *>(memory);
+            page->next = pages;
+            page->next_free = nullptr;
+            page->live = 0;
+            for (std::size_t word = 0; word < kBitmapWords; word++)
+                page->occupied[word] = 0;
+            pages = page;
+            freePages = page;
+        }
+
+        Page *page = freePages;
+        std::size_t word = 0;
+        while (page->occupied[word] == ~std::uint64_t(0))
+            word++;
+        std::size_t index = word * 64 + __builtin_ctzll(~page->occupied[word]);
+        page->occupied[word] |= std::uint64_t(1) << (index % 64);
+        if (++page->live == kSlotsPerPage) // Full: leave the list of pages with free slots
+            freePages = page->next_free;
+        live++;
+        return page->slots() + index * sizeof(T);
+    }
+
+    // Function to mark the slot of an object (already destroyed, or never constructed) free again
+    void releaseSlot(T *object)
+    {
+        Page *page = pageOf(object);
+        std::size_t index = static_cast<std::size_t>(reinterpret_cast<char *>(object) - page->slots()) / sizeof(T);
+        page->occupied[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+        if (page->live-- == kSlotsPerPage) // A full page can hand out slots again
+        {
+            page->next_free = freePages;
+            freePages = page;
+        }
+        live--;
+    }
+
+    Page *pages = nullptr;     // Every page of the pool
+    Page *freePages = nullptr; // Pages with at least one free slot
+    std::size_t live = 0;      // Objects currently constructed
+};
+
+#endif
@@ -0,0 +1,190 @@
+// Checks for ObjectPool<T> (objectpool.hpp); exits with 1 and names the failed check when something is wrong
+// Build (main.c without its own main), ideally with -fsanitize=address,undefined on both commands:
+//     gcc -O2 -pthread -DMEMORYHELP_NO_MAIN -c main.c -o memoryhelp.o
+//     g++ -std=c++17 -O2 -pthread objectpool_test.cpp memoryhelp.o -o objectpool_test
+// Run: ./objectpool_test
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "objectpool.hpp"
+
+static int failures = 0;
+
+// Function to record a failed check without stopping, so one run reports every problem
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// Counts constructions and destructions, so a leaked or doubly destroyed object shows up as a mismatch
+struct Tracked
+{
+    static long constructed;
+    static long destroyed;
+    long value;
+    char padding[40];
+
+    explicit Tracked(long v) : value(v)
+    {
+        constructed++;
+    }
+    ~Tracked()
+    {
+        destroyed++;
+    }
+};
+long Tracked::constructed = 0;
+long Tracked::destroyed = 0;
+
+// Over-aligned type: every slot must honour alignof, not only the pointer size the heap guarantees
+struct alignas(64) Wide
+{
+    long value;
+};
+
+// Throws from its constructor when asked to, after noting where it was being built
+struct Throwing
+{
+    static long constructed;
+    static long destroyed;
+    static void *lastAttempt;
+    long value;
+
+    explicit Throwing(bool fail) : value(1)
+    {
+        lastAttempt = this;
+        if (fail)
+            throw std::runtime_error("constructor failed");
+        constructed++;
+    }
+    ~Throwing()
+    {
+        destroyed++;
+    }
+};
+long Throwing::constructed = 0;
+long Throwing::destroyed = 0;
+void *Throwing::lastAttempt = nullptr;
+
+// Function to check that emplace/destroy balance and that destroyed slots are handed out again
+static void test_reuse()
+{
+    ObjectPool<Tracked> pool;
+    Tracked *first = pool.emplace(1);
+    Tracked *second = pool.emplace(2);
+    check(first != nullptr && second != nullptr && first != second, "emplace returns distinct objects");
+    check(first->value == 1 && second->value == 2, "constructor arguments are forwarded");
+    pool.destroy(first);
+    Tracked *third = pool.emplace(3);
+    check(third == first, "a destroyed slot is reused by the next emplace");
+    check(pool.size() == 2, "size counts live objects");
+    pool.destroy(second);
+    pool.destroy(third);
+    check(pool.size() == 0, "size drops to 0 after destroying everything");
+    check(Tracked::constructed == Tracked::destroyed, "every construction has a destruction");
+}
+
+// Function to fill several pages, free every other object, and check the pool finds the holes again
+static void test_many_pages()
+{
+    ObjectPool<Tracked> pool;
+    std::size_t count = ObjectPool<Tracked>::slotsPerPage() * 5 + 3;
+    std::vector<Tracked *> objects;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        Tracked *object = pool.emplace(static_cast<long>(i));
+        if (object == nullptr)
+        {
+            check(false, "the heap supplies enough pages");
+            return;
+        }
+        objects.push_back(object);
+    }
+    bool intact = true;
+    for (std::size_t i = 0; i < count; i++)
+        intact = intact && objects[i]->value == static_cast<long>(i);
+    check(intact, "objects on different pages do not overlap");
+
+    for (std::size_t i = 0; i < count; i += 2)
+        pool.destroy(objects[i]);
+    std::size_t reused = 0;
+    for (std::size_t i = 0; i < count; i += 2)
+    {
+        Tracked *object = pool.emplace(-1);
+        for (std::size_t j = 0; j < count; j += 2)
+            reused += object == objects[j];
+    }
+    check(reused == (count + 1) / 2, "every freed slot on every page is reused before a new page is taken");
+}
+
+// Function to check that clear() runs the destructor of every live object exactly once
+static void test_clear()
+{
+    long before = Tracked::destroyed;
+    ObjectPool<Tracked> pool;
+    for (int i = 0; i < 1000; i++)
+        pool.emplace(i);
+    pool.clear();
+    check(Tracked::destroyed - before == 1000, "clear destroys every live object");
+    check(pool.size() == 0, "the pool is empty after clear");
+    check(pool.emplace(7) != nullptr, "the pool works again after clear");
+}
+
+// Function to check that a constructor that throws leaves the pool as it was: the exception reaches the caller, the
+// slot is free again (even when it was the last free slot of its page), and clear() never destroys it
+static void test_throwing_constructor()
+{
+    ObjectPool<Throwing> pool;
+    for (std::size_t i = 0; i + 1 < ObjectPool<Throwing>::slotsPerPage(); i++)
+        pool.emplace(false);
+
+    bool thrown = false;
+    try
+    {
+        pool.emplace(true); // Takes the last slot of the first page
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    check(thrown, "the constructor's exception reaches the caller");
+    check(pool.size() == ObjectPool<Throwing>::slotsPerPage() - 1, "a failed construction is not counted");
+    void *failedSlot = Throwing::lastAttempt;
+    check(pool.emplace(false) == failedSlot, "the slot of a failed construction is handed out again");
+
+    pool.clear();
+    check(Throwing::constructed == Throwing::destroyed, "clear destroys only objects that were constructed");
+}
+
+// Function to check the alignment of an over-aligned type across pages
+static void test_alignment()
+{
+    ObjectPool<Wide> pool;
+    bool aligned = true;
+    for (std::size_t i = 0; i < ObjectPool<Wide>::slotsPerPage() * 3; i++)
+    {
+        Wide *object = pool.emplace();
+        aligned = aligned && object != nullptr && reinterpret_cast<std::uintptr_t>(object) % alignof(Wide) == 0;
+    }
+    check(aligned, "slots are aligned for an over-aligned type");
+}
+
+int main()
+{
+    my_initialize_heap(16 << 20);
+    test_reuse();
+    test_many_pages();
+    test_clear();
+    test_throwing_constructor();
+    test_alignment();
+    check(Tracked::constructed == Tracked::destroyed, "constructions and destructions balance at the end");
+    if (failures == 0)
+        std::printf("All ObjectPool checks passed.\n");
+    return failures == 0 ? 0 : 1;
+}
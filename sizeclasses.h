@@ -0,0 +1,69 @@
+// Generated by sizeclassgen; do not edit. Regenerate from a new trace instead.
+// 76024 requests, 297 distinct sizes, 32 classes, 503200 bytes (2.82%) lost to rounding
+#ifndef SIZECLASSES_H
+#define SIZECLASSES_H
+
+#ifdef __cplusplus
+#define SIZE_CLASS_TABLE constexpr
+#else
+#define SIZE_CLASS_TABLE static const
+#endif
+
+#define SIZE_CLASS_GRANULE 8
+#define SIZE_CLASS_COUNT 32
+#define SIZE_CLASS_MAX 4080 // Requests above this size have no class
+
+SIZE_CLASS_TABLE unsigned short size_class_sizes[SIZE_CLASS_COUNT] = {
+    24, 40, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192,
+    208, 224, 240, 256, 280, 304, 328, 352, 376, 392, 416, 440,
+    464, 488, 512, 1136, 1704, 2272, 3200, 4080
+};
+
+// size_class_lookup[(size + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE] is the class size for size
+SIZE_CLASS_TABLE unsigned short size_class_lookup[SIZE_CLASS_MAX / SIZE_CLASS_GRANULE + 1] = {
+    24, 24, 24, 24, 40, 40, 56, 56, 64, 80, 80, 96,
+    96, 112, 112, 128, 128, 144, 144, 160, 160, 176, 176, 192,
+    192, 208, 208, 224, 224, 240, 240, 256, 256, 280, 280, 280,
+    304, 304, 304, 328, 328, 328, 352, 352, 352, 376, 376, 376,
+    392, 392, 416, 416, 416, 440, 440, 440, 464, 464, 464, 488,
+    488, 488, 512, 512, 512, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136,
+    1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1136, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704,
+    1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 1704, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272,
+    2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 2272, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200, 3200,
+    3200, 3200, 3200, 3200, 3200, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080, 4080,
+    4080, 4080, 4080, 4080, 4080, 4080, 4080
+};
+
+#endif
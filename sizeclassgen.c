@@ -0,0 +1,185 @@
+// Size-class table generator: reads allocation sizes recorded from a workload and writes a header with the size
+// classes that waste the fewest bytes to rounding, given a cap on the number of classes.
+//
+// Input (a file or standard input): one allocation per line as "size", or a histogram as "size count" lines, such as
+// the file main.c writes when run with MY_MALLOC_CONF=size_histogram:<path>. Lines starting with # are ignored.
+//
+// Build and run:
+//     gcc -O2 -o sizeclassgen sizeclassgen.c
+//     ./sizeclassgen [-k classes] [-g granule] [input] > sizeclasses.h
+//
+// Every class is a multiple of the granule (the allocator's pointer-size rounding), and the largest size seen always
+// gets a class of its own, so every recorded request fits some class. The classes are chosen by dynamic programming
+// over the distinct sizes: best[k][j] is the least waste when sizes 0..j are served by k classes with the largest
+// class exactly at size j. The waste of a class counts, for every request it serves, the bytes between the request
+// and the class size.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TRACKED_SIZE 65536 // Classes go up to this size; larger requests are left to the allocator's own rounding
+#define MAX_CLASSES 256
+
+static long long counts[MAX_TRACKED_SIZE + 1]; // counts[s]: requests of s bytes (after rounding to the granule)
+
+// Function to print how the tool is used and exit
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-k classes (1-%d, default 32)] [-g granule (power of two, default 8)] [input]\n",
+            program, MAX_CLASSES);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int maxClasses = 32, granule = 8;
+    const char *inputPath = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            maxClasses = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            granule = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+            usage(argv[0]);
+        else
+            inputPath = argv[i];
+    }
+    if (maxClasses < 1 || maxClasses > MAX_CLASSES || granule < 1 || (granule & (granule - 1)) != 0 || granule > 4096)
+        usage(argv[0]);
+
+    FILE *input = inputPath != NULL ? fopen(inputPath, "r") : stdin;
+    if (input == NULL)
+    {
+        fprintf(stderr, "Could not open %s.\n", inputPath);
+        return 1;
+    }
+
+    // Read the sizes, rounding each to the granule the allocator rounds to anyway
+    char line[256];
+    long long requests = 0, skipped = 0;
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        long size;
+        long long count = 1;
+        if (line[0] == '#' || sscanf(line, "%ld %lld", &size, &count) < 1)
+            continue;
+        if (size <= 0 || count <= 0)
+            continue;
+        long rounded = (size + granule - 1) & ~(long)(granule - 1);
+        if (rounded > MAX_TRACKED_SIZE)
+        {
+            skipped += count;
+            continue;
+        }
+        counts[rounded] += count;
+        requests += count;
+    }
+    if (input != stdin)
+        fclose(input);
+    if (requests == 0)
+    {
+        fprintf(stderr, "No allocation sizes found in the input.\n");
+        return 1;
+    }
+
+    // The distinct sizes, in increasing order, with prefix sums of counts and of count * size
+    static long sizes[MAX_TRACKED_SIZE + 1];
+    static long long prefixCount[MAX_TRACKED_SIZE + 2], prefixBytes[MAX_TRACKED_SIZE + 2];
+    int distinct = 0;
+    for (long s = granule; s <= MAX_TRACKED_SIZE; s += granule)
+    {
+        if (counts[s] == 0)
+            continue;
+        sizes[distinct] = s;
+        prefixCount[distinct + 1] = prefixCount[distinct] + counts[s];
+        prefixBytes[distinct + 1] = prefixBytes[distinct] + counts[s] * s;
+        distinct++;
+    }
+    int classes = maxClasses < distinct ? maxClasses : distinct;
+
+    // waste(i, j): bytes lost when sizes i..j are all rounded up to sizes[j]
+#define WASTE(i, j) ((prefixCount[(j) + 1] - prefixCount[i]) * sizes[j] - (prefixBytes[(j) + 1] - prefixBytes[i]))
+
+    long long *best = malloc(sizeof(long long) * (size_t)classes * distinct);
+    int *previous = malloc(sizeof(int) * (size_t)classes * distinct);
+    if (best == NULL || previous == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    for (int j = 0; j < distinct; j++)
+    {
+        best[j] = WASTE(0, j);
+        previous[j] = -1;
+    }
+    for (int k = 1; k < classes; k++)
+    {
+        for (int j = 0; j < distinct; j++)
+        {
+            long long *row = &best[(size_t)k * distinct];
+            row[j] = best[(size_t)(k - 1) * distinct + j]; // Using fewer classes is always allowed
+            previous[(size_t)k * distinct + j] = previous[(size_t)(k - 1) * distinct + j];
+            for (int i = 0; i < j; i++)
+            {
+                long long cost = best[(size_t)(k - 1) * distinct + i] + WASTE(i + 1, j);
+                if (cost < row[j])
+                {
+                    row[j] = cost;
+                    previous[(size_t)k * distinct + j] = i;
+                }
+            }
+        }
+    }
+
+    // Walk back from the largest size to recover the class boundaries
+    long classSizes[MAX_CLASSES];
+    int used = 0;
+    for (int k = classes - 1, j = distinct - 1; j >= 0; k--)
+    {
+        classSizes[used++] = sizes[j];
+        j = previous[(size_t)k * distinct + j];
+        if (k == 0)
+            break;
+    }
+    for (int i = 0; i < used / 2; i++)
+    {
+        long swap = classSizes[i];
+        classSizes[i] = classSizes[used - 1 - i];
+        classSizes[used - 1 - i] = swap;
+    }
+    long long waste = best[(size_t)(classes - 1) * distinct + distinct - 1];
+    long maxSize = classSizes[used - 1];
+
+    // Emit the header: the classes and a lookup table indexed by (size + granule - 1) / granule
+    printf("// Generated by sizeclassgen; do not edit. Regenerate from a new trace instead.\n");
+    printf("// %lld requests, %d distinct sizes, %d classes, %lld bytes (%.2f%%) lost to rounding",
+           requests, distinct, used, waste, 100.0 * waste / (prefixBytes[distinct] + waste));
+    if (skipped > 0)
+        printf(", %lld requests above %d bytes left out", skipped, MAX_TRACKED_SIZE);
+    printf("\n#ifndef SIZECLASSES_H\n#define SIZECLASSES_H\n\n");
+    printf("#ifdef __cplusplus\n#define SIZE_CLASS_TABLE constexpr\n#else\n#define SIZE_CLASS_TABLE static const\n#endif\n\n");
+    printf("#define SIZE_CLASS_GRANULE %d\n", granule);
+    printf("#define SIZE_CLASS_COUNT %d\n", used);
+    printf("#define SIZE_CLASS_MAX %ld // Requests above this size have no class\n\n", maxSize);
+
+    printf("SIZE_CLASS_TABLE unsigned short size_class_sizes[SIZE_CLASS_COUNT] = {");
+    for (int i = 0; i < used; i++)
+        printf("%s%s%ld", i > 0 ? "," : "", i % 12 == 0 ? "\n    " : " ", classSizes[i]);
+    printf("\n};\n\n");
+
+    printf("// size_class_lookup[(size + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE] is the class size for size\n");
+    printf("SIZE_CLASS_TABLE unsigned short size_class_lookup[SIZE_CLASS_MAX / SIZE_CLASS_GRANULE + 1] = {");
+    int current = 0;
+    for (long index = 0; index <= maxSize / granule; index++)
+    {
+        while (classSizes[current] < index * granule)
+            current++;
+        printf("%s%s%ld", index > 0 ? "," : "", index % 12 == 0 ? "\n    " : " ", classSizes[current]);
+    }
+    printf("\n};\n\n#endif\n");
+
+    free(best);
+    free(previous);
+    return 0;
+}